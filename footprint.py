@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+"""RAM/flash/stack footprint report for keymap.c.
+
+Run after `qmk compile -e FOOTPRINT=callgraph` (GCC 10+) or
+`qmk compile -e FOOTPRINT=yes` (older avr-gcc):
+
+    python3 footprint.py .build/<target>.map .build/obj_<target>/.../keymap.ci [more.su ...]
+
+The map file comes from the normal QMK link. The .ci call graph comes from
+-fcallgraph-info=su; a plain -fstack-usage .su file is also accepted but only
+gives per-function frames, not a peak. Any further .su/.ci files (for example
+from a libc built with -fstack-usage) only add frames for callees.
+
+Each recursive cycle is counted to the depth it can really reach, see
+recursion_levels(). Callees with no known frame, such as libc and the
+function pointers te_eval calls, are listed as not counted rather than
+taken as 0 bytes.
+"""
+
+import os
+import re
+import sys
+
+OBJECT = "keymap.o"
+ENTRY_POINTS = ("process_record_user", "oled_task_user", "encoder_update_user", "keyboard_post_init_user")
+
+RAM_ONLY = (".bss", ".noinit")
+RAM_AND_FLASH = (".data",)
+NOT_LOADED = (".debug", ".comment", ".stab", ".note", ".ARM.attributes", ".stack")
+
+
+def recursion_levels():
+    """Levels each recursive keymap.c function can reach for a full expressions_buffer."""
+    with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), "keymap.c")) as f:
+        source = f.read()
+    size = int(re.search(r"#define EXPRESSIONS_BUFF_SIZE (\d+)", source).group(1))
+
+    # Deepest syntax tree; test/tinyexpr_fuzz.c asserts the same bound.
+    tree = size // 2 + 1
+    # base() only calls back into power() for a unary function token, so that cycle
+    # repeats once per such token; there are none unless functions[] has one.
+    unary = re.search(r'\{"\w+",[^}]*TE_(?:FUNCTION|CLOSURE)1\b', source)
+    tokens = size - 1 if unary else 0
+
+    levels = dict.fromkeys(("te_eval", "te_free", "te_free_parameters", "optimize"), tree)
+    levels.update(dict.fromkeys(("base", "power"), tokens + 1))
+    levels["simplify"] = 2  # only 0-x -> -x calls simplify() again, on a negate node
+    return levels
+
+
+def kind_of(output_section):
+    if output_section.startswith(NOT_LOADED):
+        return None
+    if output_section.startswith(RAM_ONLY):
+        return "ram"
+    if output_section.startswith(RAM_AND_FLASH):
+        return "ram+flash"
+    return "flash"
+
+
+def parse_map(path):
+    """Returns ({output section: size}, [(input section, kind, size)] for keymap.o)."""
+    outputs = {}
+    parts = []
+    output = None
+    pending = None  # input section name whose address/size is on the next line
+
+    with open(path) as f:
+        lines = f.read().split("Linker script and memory map", 1)[-1].splitlines()
+
+    for line in lines:
+        m = re.match(r"^(\.\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)", line)
+        if m:
+            output = m.group(1)
+            outputs[output] = int(m.group(3), 16)
+            pending = None
+            continue
+        if re.match(r"^\.\S+\s*$", line):
+            output = line.strip()
+            continue
+
+        m = re.match(r"^ (\S+)\s*$", line)
+        if m and not line.strip().startswith("0x"):
+            pending = m.group(1)
+            continue
+
+        m = re.match(r"^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S+)", line)
+        if m:
+            name = m.group(1) or pending
+            pending = None
+            size = int(m.group(3), 16)
+            kind = kind_of(output or "")
+            if kind and size and m.group(4).endswith(OBJECT):
+                parts.append((name, kind, size))
+
+    return outputs, parts
+
+
+def parse_callgraph(path):
+    """Returns ({function: frame bytes}, {function: [callees]}, {function: dynamic})."""
+    frames = {}
+    dynamic = {}
+    calls = {}
+    name = lambda title: title.rsplit(":", 1)[-1]
+
+    with open(path) as f:
+        text = f.read()
+
+    if path.endswith(".su"):
+        for line in text.splitlines():
+            location, size, qualifier = line.split("\t")
+            fn = name(location)
+            frames[fn] = int(size)
+            dynamic[fn] = qualifier != "static"
+        return frames, calls, dynamic
+
+    for m in re.finditer(r'node: \{ title: "([^"]*)" label: "([^"]*)"', text):
+        fn = name(m.group(1))
+        s = re.search(r"(\d+) bytes \((\w[\w,]*)\)", m.group(2))
+        if s:
+            frames[fn] = int(s.group(1))
+            dynamic[fn] = s.group(2) != "static"
+    for m in re.finditer(r'edge: \{ sourcename: "([^"]*)" targetname: "([^"]*)"', text):
+        callees = calls.setdefault(name(m.group(1)), [])
+        if name(m.group(2)) not in callees:
+            callees.append(name(m.group(2)))
+    return frames, calls, dynamic
+
+
+def peak_stack(fn, frames, calls, levels, active=()):
+    """Deepest call chain from fn, or None if it goes through a cycle with no known bound.
+
+    A cycle entered at a function in levels repeats until that many levels are on the stack.
+    """
+    if fn in active:
+        if fn not in levels:
+            return None, [fn + " (recursive, unbounded)"]
+        cycle = active[active.index(fn):]
+        repeats = levels[fn] - 1
+        return sum(frames.get(f, 0) for f in cycle) * repeats, ["%s (recursive x%d)" % (fn, repeats)]
+    best, path = 0, []
+    for callee in calls.get(fn, []):
+        depth, chain = peak_stack(callee, frames, calls, levels, active + (fn,))
+        if depth is None:
+            return None, [fn] + chain
+        if depth > best or not path:
+            best, path = depth, chain
+    return frames.get(fn, 0) + best, [fn] + path
+
+
+def not_counted(entry, frames, calls):
+    """Callees reachable from entry whose frames are unknown, as "callee (from caller)"."""
+    seen, todo, missing = set(), [entry], []
+    while todo:
+        fn = todo.pop()
+        if fn in seen:
+            continue
+        seen.add(fn)
+        for callee in calls.get(fn, []):
+            if callee in frames:
+                todo.append(callee)
+            else:
+                missing.append("%s (from %s)" % ("indirect call" if callee == "__indirect_call" else callee, fn))
+    return sorted(set(missing))
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.exit(__doc__)
+
+    outputs, parts = parse_map(argv[1])
+    ram = sum(size for section, size in outputs.items() if kind_of(section) in ("ram", "ram+flash"))
+    flash = sum(size for section, size in outputs.items() if kind_of(section) in ("flash", "ram+flash"))
+    print("Firmware: %d bytes static RAM, %d bytes flash" % (ram, flash))
+    print()
+
+    print("%s by section:" % OBJECT)
+    totals = {"ram": 0, "flash": 0}
+    for name, kind, size in sorted(parts, key=lambda p: -p[2]):
+        for k in kind.split("+"):
+            totals[k] += size
+        print("  %6d  %-9s %s" % (size, kind, name))
+    print("  %6d  ram" % totals["ram"])
+    print("  %6d  flash" % totals["flash"])
+
+    if len(argv) < 3:
+        return
+
+    frames, calls, dynamic = parse_callgraph(argv[2])
+    for extra in argv[3:]:
+        extra_frames, _, _ = parse_callgraph(extra)
+        for fn, size in extra_frames.items():
+            frames.setdefault(fn, size)
+    print()
+    print("Stack frames:")
+    for fn, size in sorted(frames.items(), key=lambda f: -f[1]):
+        print("  %6d  %s%s" % (size, fn, " (dynamic)" if dynamic.get(fn) else ""))
+
+    if calls:
+        print()
+        levels = recursion_levels()
+        print("Peak stack from each entry point, counting only known frames:")
+        for entry in ENTRY_POINTS:
+            if entry in frames:
+                depth, chain = peak_stack(entry, frames, calls, levels)
+                print("  %6s  %s" % ("?" if depth is None else depth, " -> ".join(chain)))
+                for callee in not_counted(entry, frames, calls):
+                    print("          + not counted: %s" % callee)
+    else:
+        print()
+        print("No call graph in %s, so no peak; build with FOOTPRINT=callgraph for one." % argv[2])
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -22,9 +22,39 @@
 #include QMK_KEYBOARD_H
 
 #define EXPRESSIONS_BUFF_SIZE 64
-int input_count = 0;                            // stores the count of the filled in expressions_buffer.
-char expressions_buffer[EXPRESSIONS_BUFF_SIZE]; // stores the typed out string
-char last_answer[EXPRESSIONS_BUFF_SIZE];        // stores the previous answer
+#define ANSWER_BUFF_SIZE 24     // fits "-999999999999999.99" from dtostrf; larger answers use dtostre
+#define ANSWER_FIXED_MAX 1e15   // answers at or above this are shown in exponent form
+#define CALC_STATE_BUDGET 160   // SRAM allowed for calc_state_t, checked at compile time
+
+// Memory registers, used in expressions as m and a-f
+enum memory_slots {
+    MEM_M = 0,
+    MEM_A,
+    MEM_B,
+    MEM_C,
+    MEM_D,
+    MEM_E,
+    MEM_F,
+    MEM_COUNT,
+};
+
+// All calculator state lives here so its SRAM cost is one number.
+// Members are ordered widest first so the compiler adds no padding between them,
+// and the registers stay aligned for the pointers TinyExpr binds to them.
+typedef struct calc_state_t {
+    double last_value;                              // stores the previous answer as a number
+    double memory[MEM_COUNT];                       // memory registers
+    char expressions_buffer[EXPRESSIONS_BUFF_SIZE]; // stores the typed out string
+    char last_answer[ANSWER_BUFF_SIZE];             // stores the previous answer, formatted for display
+    uint8_t input_count;                            // stores the count of the filled in expressions_buffer.
+    bool mem_store_pending : 1;                     // next A-F key stores the answer instead of typing the register
+    bool mem_layer_used : 1;                        // a memory key was pressed while the memory layer was held
+} calc_state_t;
+
+_Static_assert(EXPRESSIONS_BUFF_SIZE - 1 <= UINT8_MAX, "input_count must be able to index expressions_buffer");
+_Static_assert(sizeof(calc_state_t) <= CALC_STATE_BUDGET, "calculator state is over its SRAM budget");
+
+calc_state_t calc;
 
 // TinyExpr definitions
 typedef struct te_expr {
@@ -68,6 +98,8 @@ void te_print(const te_expr *n);
 void te_free(te_expr *n);
 
 void write_char_to_buff(char c);
+void write_register_to_buff(char c);
+void evaluate_buff(void);
 
 enum layer_codes {
     L3_1 = SAFE_RANGE,
@@ -88,6 +120,17 @@ enum layer_codes {
     L3_DOT,
     L3_PRINT_ANS,
     L3_EXIT,
+    L3_MEM_PLUS,
+    L3_MEM_MINUS,
+    L3_MEM_RECALL,
+    L3_MEM_CLEAR,
+    L3_MEM_STORE,
+    L3_REG_A,
+    L3_REG_B,
+    L3_REG_C,
+    L3_REG_D,
+    L3_REG_E,
+    L3_REG_F,
 };
 
 //Layout
@@ -120,6 +163,13 @@ const uint16_t PROGMEM keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
                 L3_1,    L3_2,     L3_3,          
     L3_PRINT_ANS,L3_0,   L3_0,     L3_DOT,      L3_EQUALS),
 
+    [4] = LAYOUT( // memory, held from L3_PRINT_ANS
+                L3_MEM_CLEAR, L3_MEM_RECALL, L3_MEM_MINUS, L3_MEM_PLUS,
+                L3_REG_A,     L3_REG_B,      L3_REG_C,
+                L3_REG_D,     L3_REG_E,      L3_REG_F,     L3_MEM_STORE,
+                KC_TRNS,      KC_TRNS,       KC_TRNS,
+        KC_TRNS,KC_TRNS,      KC_TRNS,       KC_TRNS,      KC_TRNS),
+
 };
 
 bool encoder_update_user(uint8_t index, bool clockwise) {
@@ -212,25 +262,84 @@ bool process_record_user(uint16_t keycode, keyrecord_t *record) {
             break;
         case L3_EQUALS:
             if (record->event.pressed) {
-                double result = te_interp(expressions_buffer, 0);
-                char output_string[EXPRESSIONS_BUFF_SIZE];
-                dtostrf(result, 1, 2, output_string);
-                strcpy(last_answer,output_string);
-                input_count = 0;
+                evaluate_buff();
+            }
+            break;
+        case L3_PRINT_ANS: // tap prints the answer, hold opens the memory layer
+            if (record->event.pressed) {
+                calc.mem_layer_used = false;
+                layer_on(4);
+            } else {
+                layer_off(4);
+                calc.mem_store_pending = false;
+                if(!calc.mem_layer_used && calc.input_count==0){
+                    send_string(calc.last_answer);
+                }
             }
             break;
-        case L3_PRINT_ANS:
+        case L3_MEM_PLUS:
             if (record->event.pressed) {
-                if(input_count<=0){
-                    send_string(last_answer);
+                calc.mem_layer_used = true;
+                if(calc.input_count>0){
+                    evaluate_buff();
+                }
+                if(!isnan(calc.last_value)){
+                    calc.memory[MEM_M] += calc.last_value;
+                }
+            }
+            break;
+        case L3_MEM_MINUS:
+            if (record->event.pressed) {
+                calc.mem_layer_used = true;
+                if(calc.input_count>0){
+                    evaluate_buff();
+                }
+                if(!isnan(calc.last_value)){
+                    calc.memory[MEM_M] -= calc.last_value;
+                }
+            }
+            break;
+        case L3_MEM_RECALL:
+            if (record->event.pressed) {
+                calc.mem_layer_used = true;
+                write_register_to_buff('m');
+            }
+            break;
+        case L3_MEM_CLEAR:
+            if (record->event.pressed) {
+                calc.mem_layer_used = true;
+                calc.memory[MEM_M] = 0;
+            }
+            break;
+        case L3_MEM_STORE:
+            if (record->event.pressed) {
+                calc.mem_layer_used = true;
+                if(calc.input_count>0){
+                    evaluate_buff();
+                }
+                calc.mem_store_pending = true;
+            }
+            break;
+        case L3_REG_A ... L3_REG_F:
+            if (record->event.pressed) {
+                calc.mem_layer_used = true;
+                if(calc.mem_store_pending){
+                    if(!isnan(calc.last_value)){
+                        calc.memory[MEM_A + (keycode - L3_REG_A)] = calc.last_value;
+                    }
+                    calc.mem_store_pending = false;
+                }else{
+                    write_register_to_buff('a' + (keycode - L3_REG_A));
                 }
             }
             break;
         case L3_EXIT:
             if(record->event.pressed){
-                input_count = 0;
-                expressions_buffer[0] = '\0';
-                last_answer[0] = '\0';
+                calc.input_count = 0;
+                calc.expressions_buffer[0] = '\0';
+                calc.last_answer[0] = '\0';
+                calc.last_value = 0;
+                calc.mem_store_pending = false;
                 layer_move(0);
             }
             break;
@@ -240,11 +349,34 @@ bool process_record_user(uint16_t keycode, keyrecord_t *record) {
 
 
 void write_char_to_buff(char c){
-    if(input_count+1 < EXPRESSIONS_BUFF_SIZE){
-        expressions_buffer[input_count] = c;
-        expressions_buffer[input_count+1] = '\0'; // null terminator marks end of string
-        input_count++;
+    if(calc.input_count+1 < EXPRESSIONS_BUFF_SIZE){
+        calc.expressions_buffer[calc.input_count] = c;
+        calc.expressions_buffer[calc.input_count+1] = '\0'; // null terminator marks end of string
+        calc.input_count++;
+    }
+}
+
+
+void write_register_to_buff(char c){
+    // straight after a number a register would be read as part of it (5e+2 is 500), so it is ignored there
+    if(calc.input_count>0){
+        const char prev = calc.expressions_buffer[calc.input_count-1];
+        if((prev >= '0' && prev <= '9') || prev == '.'){
+            return;
+        }
     }
+    write_char_to_buff(c);
+}
+
+
+void evaluate_buff(void){
+    calc.last_value = te_interp(calc.expressions_buffer, 0);
+    if(fabs(calc.last_value) < ANSWER_FIXED_MAX){
+        dtostrf(calc.last_value, 1, 2, calc.last_answer);
+    }else{
+        dtostre(calc.last_value, calc.last_answer, 2, 0); // also covers inf and nan
+    }
+    calc.input_count = 0;
 }
 
 
@@ -289,12 +421,15 @@ typedef struct state {
 #define IS_CLOSURE(TYPE) (((TYPE) & TE_CLOSURE0) != 0)
 #define ARITY(TYPE) ( ((TYPE) & (TE_FUNCTION0 | TE_CLOSURE0)) ? ((TYPE) & 0x00000007) : 0 )
 #define NEW_EXPR(type, ...) new_expr((type), (const te_expr*[]){__VA_ARGS__})
+#define CHECK_NULL(ptr, ...) if ((ptr) == NULL) { __VA_ARGS__; return NULL; }
 
 static te_expr *new_expr(const int type, const te_expr *parameters[]) {
     const int arity = ARITY(type);
     const int psize = sizeof(void*) * arity;
     const int size = (sizeof(te_expr) - sizeof(void*)) + psize + (IS_CLOSURE(type) ? sizeof(void*) : 0);
     te_expr *ret = malloc(size);
+    CHECK_NULL(ret);
+
     memset(ret, 0, size);
     if (arity && parameters) {
         memcpy(ret->parameters, parameters, psize);
@@ -354,6 +489,14 @@ static const te_variable *find_builtin(const char *name, int len) {
     return 0;
 }
 
+static const double *find_register(const char *name, int len) {
+    /* Registers are single letters, so the slot comes straight from the name. */
+    if (len != 1) return 0;
+    if (name[0] == 'm') return &calc.memory[MEM_M];
+    if (name[0] >= 'a' && name[0] <= 'f') return &calc.memory[MEM_A + (name[0] - 'a')];
+    return 0;
+}
+
 static const te_variable *find_lookup(const state *s, const char *name, int len) {
     int iters;
     const te_variable *var;
@@ -396,10 +539,15 @@ void next_token(state *s) {
                 start = s->next;
                 while ((s->next[0] >= 'a' && s->next[0] <= 'z') || (s->next[0] >= '0' && s->next[0] <= '9') || (s->next[0] == '_')) s->next++;
 
-                const te_variable *var = find_lookup(s, start, s->next - start);
-                if (!var) var = find_builtin(start, s->next - start);
+                const double *reg = find_register(start, s->next - start);
+                const te_variable *var = 0;
+                if (!reg) var = find_lookup(s, start, s->next - start);
+                if (!reg && !var) var = find_builtin(start, s->next - start);
 
-                if (!var) {
+                if (reg) {
+                    s->type = TOK_VARIABLE;
+                    s->bound = reg;
+                } else if (!var) {
                     s->type = TOK_ERROR;
                 } else {
                     switch(TYPE_MASK(var->type))
@@ -450,12 +598,16 @@ static te_expr *base(state *s) {
     switch (TYPE_MASK(s->type)) {
         case TOK_NUMBER:
             ret = new_expr(TE_CONSTANT, 0);
+            CHECK_NULL(ret);
+
             ret->value = s->value;
             next_token(s);
             break;
 
         case TOK_VARIABLE:
             ret = new_expr(TE_VARIABLE, 0);
+            CHECK_NULL(ret);
+
             ret->bound = s->bound;
             next_token(s);
             break;
@@ -463,6 +615,8 @@ static te_expr *base(state *s) {
         case TE_FUNCTION0:
         case TE_CLOSURE0:
             ret = new_expr(s->type, 0);
+            CHECK_NULL(ret);
+
             ret->function = s->function;
             if (IS_CLOSURE(s->type)) ret->parameters[0] = s->context;
             next_token(s);
@@ -471,10 +625,13 @@ static te_expr *base(state *s) {
         case TE_FUNCTION1:
         case TE_CLOSURE1:
             ret = new_expr(s->type, 0);
+            CHECK_NULL(ret);
+
             ret->function = s->function;
             if (IS_CLOSURE(s->type)) ret->parameters[1] = s->context;
             next_token(s);
             ret->parameters[0] = power(s);
+            CHECK_NULL(ret->parameters[0], te_free(ret));
             break;
 
         case TE_FUNCTION2: case TE_FUNCTION3: case TE_FUNCTION4:
@@ -484,6 +641,8 @@ static te_expr *base(state *s) {
             arity = ARITY(s->type);
 
             ret = new_expr(s->type, 0);
+            CHECK_NULL(ret);
+
             ret->function = s->function;
             if (IS_CLOSURE(s->type)) ret->parameters[arity] = s->context;
             next_token(s);
@@ -493,6 +652,8 @@ static te_expr *base(state *s) {
 
         default:
             ret = new_expr(0, 0);
+            CHECK_NULL(ret);
+
             s->type = TOK_ERROR;
             ret->value = NAN;
             break;
@@ -515,7 +676,12 @@ static te_expr *power(state *s) {
     if (sign == 1) {
         ret = base(s);
     } else {
-        ret = NEW_EXPR(TE_FUNCTION1 | TE_FLAG_PURE, base(s));
+        te_expr *b = base(s);
+        CHECK_NULL(b);
+
+        ret = NEW_EXPR(TE_FUNCTION1 | TE_FLAG_PURE, b);
+        CHECK_NULL(ret, te_free(b));
+
         ret->function = negate;
     }
 
@@ -526,11 +692,18 @@ static te_expr *power(state *s) {
 static te_expr *factor(state *s) {
     /* <factor>    =    <power> {"^" <power>} */
     te_expr *ret = power(s);
+    CHECK_NULL(ret);
 
     while (s->type == TOK_INFIX && (s->function == pow)) {
         te_fun2 t = s->function;
         next_token(s);
-        ret = NEW_EXPR(TE_FUNCTION2 | TE_FLAG_PURE, ret, power(s));
+        te_expr *p = power(s);
+        CHECK_NULL(p, te_free(ret));
+
+        te_expr *prev = ret;
+        ret = NEW_EXPR(TE_FUNCTION2 | TE_FLAG_PURE, ret, p);
+        CHECK_NULL(ret, te_free(p), te_free(prev));
+
         ret->function = t;
     }
 
@@ -542,11 +715,18 @@ static te_expr *factor(state *s) {
 static te_expr *term(state *s) {
     /* <term>      =    <factor> {("*" | "/" | "%") <factor>} */
     te_expr *ret = factor(s);
+    CHECK_NULL(ret);
 
     while (s->type == TOK_INFIX && (s->function == mul || s->function == divide || s->function == fmod)) {
         te_fun2 t = s->function;
         next_token(s);
-        ret = NEW_EXPR(TE_FUNCTION2 | TE_FLAG_PURE, ret, factor(s));
+        te_expr *f = factor(s);
+        CHECK_NULL(f, te_free(ret));
+
+        te_expr *prev = ret;
+        ret = NEW_EXPR(TE_FUNCTION2 | TE_FLAG_PURE, ret, f);
+        CHECK_NULL(ret, te_free(f), te_free(prev));
+
         ret->function = t;
     }
 
@@ -557,11 +737,18 @@ static te_expr *term(state *s) {
 static te_expr *expr(state *s) {
     /* <expr>      =    <term> {("+" | "-") <term>} */
     te_expr *ret = term(s);
+    CHECK_NULL(ret);
 
     while (s->type == TOK_INFIX && (s->function == add || s->function == sub)) {
         te_fun2 t = s->function;
         next_token(s);
-        ret = NEW_EXPR(TE_FUNCTION2 | TE_FLAG_PURE, ret, term(s));
+        te_expr *te = term(s);
+        CHECK_NULL(te, te_free(ret));
+
+        te_expr *prev = ret;
+        ret = NEW_EXPR(TE_FUNCTION2 | TE_FLAG_PURE, ret, te);
+        CHECK_NULL(ret, te_free(te), te_free(prev));
+
         ret->function = t;
     }
 
@@ -623,10 +810,104 @@ double te_eval(const te_expr *n) {
 #undef TE_FUN
 #undef M_tinyexpr
 
-static void optimize(te_expr *n) {
-    /* Evaluates as much as possible. */
-    if (n->type == TE_CONSTANT) return;
-    if (n->type == TE_VARIABLE) return;
+#define IS_CONSTANT(e, v) (((te_expr*)(e))->type == TE_CONSTANT && ((te_expr*)(e))->value == (v))
+#define IS_NEGATE(e) (((te_expr*)(e))->type == (TE_FUNCTION1 | TE_FLAG_PURE) && ((te_expr*)(e))->function == negate)
+
+static te_expr *take_parameter(te_expr *n, int i) {
+    /* Frees n and all of its other parameters, returning parameter i. */
+    te_expr *ret = n->parameters[i];
+    n->parameters[i] = 0;
+    te_free(n);
+    return ret;
+}
+
+
+static void make_constant(te_expr *n, double value) {
+    te_free_parameters(n);
+    n->type = TE_CONSTANT;
+    n->value = value;
+}
+
+
+static int is_exact_reciprocal(double c) {
+    /* 1/c is exact only when c is a power of two and 1/c neither overflows nor underflows. */
+    int exponent;
+    const double mantissa = frexp(c, &exponent);
+    if (mantissa != 0.5 && mantissa != -0.5) return 0;
+    const double r = 1.0 / c;
+    return r != 0.0 && !isinf(r);
+}
+
+
+static te_expr *simplify(te_expr *n) {
+    /* Rewrites a pure node whose parameters are optimized but not all constant.
+     * Results keep inf and nan; only the sign of a zero result may differ. */
+    if (IS_NEGATE(n)) {
+        /* -(-x) */
+        if (IS_NEGATE(n->parameters[0])) {
+            return take_parameter(take_parameter(n, 0), 0);
+        }
+        return n;
+    }
+
+    if (ARITY(n->type) != 2) return n;
+
+    te_expr *a = n->parameters[0];
+    te_expr *b = n->parameters[1];
+
+    if (n->function == add) {
+        if (IS_CONSTANT(b, 0)) return take_parameter(n, 0);
+        if (IS_CONSTANT(a, 0)) return take_parameter(n, 1);
+    } else if (n->function == sub) {
+        if (IS_CONSTANT(b, 0)) return take_parameter(n, 0);
+        if (IS_CONSTANT(a, 0)) {
+            /* 0-x becomes -x, reusing this node. */
+            te_free(a);
+            n->type = TE_FUNCTION1 | TE_FLAG_PURE;
+            n->function = negate;
+            n->parameters[0] = b;
+            n->parameters[1] = 0;
+            return simplify(n);
+        }
+    } else if (n->function == mul) {
+        /* x*0 is left alone: a register can hold inf or nan, and those must not become 0. */
+        if (IS_CONSTANT(b, 1)) return take_parameter(n, 0);
+        if (IS_CONSTANT(a, 1)) return take_parameter(n, 1);
+    } else if (n->function == divide) {
+        if (IS_CONSTANT(b, 1)) return take_parameter(n, 0);
+        if (b->type == TE_CONSTANT && is_exact_reciprocal(b->value)) {
+            n->function = mul;
+            b->value = 1.0 / b->value;
+        }
+    } else if (n->function == pow) {
+        if (IS_CONSTANT(b, 0)) {
+            make_constant(n, 1.0);
+            return n;
+        }
+        if (IS_CONSTANT(b, 1)) return take_parameter(n, 0);
+        /* x^2 becomes x*x, reusing the exponent node as the second x. Higher powers are
+         * deliberately left to pow, on the AVR too: x*x*x rounds differently from pow, so
+         * the shown answer could change, and the chain's speed-up has not been measured
+         * on the target. */
+        if (IS_NEGATE(a) && ((te_expr*)a->parameters[0])->type == TE_VARIABLE && IS_CONSTANT(b, 2)) {
+            /* (-x)^2 is x^2 */
+            a = n->parameters[0] = take_parameter(a, 0);
+        }
+        if (a->type == TE_VARIABLE && IS_CONSTANT(b, 2)) {
+            n->function = mul;
+            b->type = TE_VARIABLE;
+            b->bound = a->bound;
+        }
+    }
+
+    return n;
+}
+
+
+static te_expr *optimize(te_expr *n) {
+    /* Evaluates as much as possible, then simplifies what is left. */
+    if (n->type == TE_CONSTANT) return n;
+    if (n->type == TE_VARIABLE) return n;
 
     /* Only optimize out functions flagged as pure. */
     if (IS_PURE(n->type)) {
@@ -634,18 +915,19 @@ static void optimize(te_expr *n) {
         int known = 1;
         int i;
         for (i = 0; i < arity; ++i) {
-            optimize(n->parameters[i]);
+            n->parameters[i] = optimize(n->parameters[i]);
             if (((te_expr*)(n->parameters[i]))->type != TE_CONSTANT) {
                 known = 0;
             }
         }
         if (known) {
-            const double value = te_eval(n);
-            te_free_parameters(n);
-            n->type = TE_CONSTANT;
-            n->value = value;
+            make_constant(n, te_eval(n));
+        } else {
+            n = simplify(n);
         }
     }
+
+    return n;
 }
 
 
@@ -657,6 +939,11 @@ te_expr *te_compile(const char *expression, const te_variable *variables, int va
 
     next_token(&s);
     te_expr *root = list(&s);
+    if (root == NULL) {
+        /* Out of heap; report it the same way as a parse error. */
+        if (error) *error = -1;
+        return NULL;
+    }
 
     if (s.type != TOK_END) {
         te_free(root);
@@ -666,7 +953,7 @@ te_expr *te_compile(const char *expression, const te_variable *variables, int va
         }
         return 0;
     } else {
-        optimize(root);
+        root = optimize(root);
         if (error) *error = 0;
         return root;
     }
@@ -710,12 +997,15 @@ bool oled_task_user(void) {
         case 3:
             oled_write_P(PSTR("CALC\n"), false);
             break;
+        case 4:
+            oled_write_P(PSTR("MEM\n"), false);
+            break;
     }
     
-    if(input_count>0){ // check for current input
-        oled_write_ln(expressions_buffer,false); // output expression
+    if(calc.input_count>0){ // check for current input
+        oled_write_ln(calc.expressions_buffer,false); // output expression
     }else{
-        oled_write_ln(last_answer,false);  // output result
+        oled_write_ln(calc.last_answer,false);  // output result
     }
     return false;
 }
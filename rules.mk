@@ -0,0 +1,11 @@
+# Stack usage output for footprint.py, off by default:
+#   qmk compile -e FOOTPRINT=yes        per-function frames (-fstack-usage, any GCC)
+#   qmk compile -e FOOTPRINT=callgraph  frames and call graph for a peak (-fcallgraph-info, GCC 10+)
+FOOTPRINT ?= no
+
+ifeq ($(strip $(FOOTPRINT)), yes)
+    EXTRAFLAGS += -fstack-usage
+endif
+ifeq ($(strip $(FOOTPRINT)), callgraph)
+    EXTRAFLAGS += -fcallgraph-info=su
+endif
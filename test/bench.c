@@ -0,0 +1,61 @@
+/* Host benchmark for the rewrites simplify() does in optimize().
+ *
+ * Each expression is compiled twice: once with only the constant folding
+ * optimize() did before simplify() existed, and once with te_compile. Both
+ * trees are evaluated with register a bound to a changing value.
+ *
+ * Run: ./run_bench.sh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define QMK_KEYBOARD_H "qmk_stub.h"
+#include "../keymap.c"
+#include "fold_only.h"
+
+#define ITERATIONS 5000000
+
+static const char *expressions[] = {
+    "a^2",
+    "a^3",      // a^3 and a^4 stay as pow, so they show the noise floor
+    "a^4",
+    "-a^2",
+    "a^2+1",
+    "a^2*2-a",
+    "a/8",
+    "a/8+a*1+0",
+    "0-a",
+};
+
+static double ns_per_eval(const te_expr *n, double *sum) {
+    const clock_t start = clock();
+    long i;
+    for (i = 0; i < ITERATIONS; ++i) {
+        calc.memory[MEM_A] = i * 1e-6;
+        *sum += te_eval(n);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ITERATIONS;
+}
+
+int main(void) {
+    size_t i;
+    int differ = 0;
+    printf("%-12s %10s %10s\n", "expression", "folded", "simplified");
+    for (i = 0; i < sizeof(expressions) / sizeof(expressions[0]); ++i) {
+        double folded_sum = 0, simplified_sum = 0;
+        te_expr *folded = compile_folded(expressions[i]);
+        te_expr *simplified = te_compile(expressions[i], 0, 0, 0);
+
+        const double before = ns_per_eval(folded, &folded_sum);
+        const double after = ns_per_eval(simplified, &simplified_sum);
+        printf("%-12s %7.1f ns %7.1f ns%s\n", expressions[i], before, after,
+               folded_sum == simplified_sum ? "" : "  (results differ)");
+        if (folded_sum != simplified_sum) differ = 1;
+
+        te_free(folded);
+        te_free(simplified);
+    }
+    return differ;
+}
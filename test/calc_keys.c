@@ -0,0 +1,154 @@
+/* Key-level checks for the calculator layer and the memory registers.
+ *
+ * Run: ./run_keys.sh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QMK_KEYBOARD_H "qmk_stub.h"
+#define OLED_ENABLE
+#include "../keymap.c"
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void key(uint16_t keycode, bool pressed) {
+    keyrecord_t record = {.event = {.pressed = pressed}};
+    process_record_user(keycode, &record);
+}
+
+static void tap(uint16_t keycode) {
+    key(keycode, true);
+    key(keycode, false);
+}
+
+static void type(const char *keys) {
+    for (; *keys; ++keys) {
+        switch (*keys) {
+            case '0': tap(L3_0); break;
+            case '+': tap(L3_PLUS); break;
+            case '-': tap(L3_MINUS); break;
+            case '*': tap(L3_MULTIPLY); break;
+            case '/': tap(L3_SLASH); break;
+            case '.': tap(L3_DOT); break;
+            case '=': tap(L3_EQUALS); break;
+            default: tap(L3_1 + (*keys - '1')); break;
+        }
+    }
+}
+
+static void memory_key(uint16_t keycode) {
+    key(L3_PRINT_ANS, true);
+    tap(keycode);
+    key(L3_PRINT_ANS, false);
+}
+
+static void store_to(uint16_t reg) {
+    key(L3_PRINT_ANS, true);
+    tap(L3_MEM_STORE);
+    tap(reg);
+    key(L3_PRINT_ANS, false);
+}
+
+static void reset(void) {
+    tap(L3_EXIT);
+    memset(calc.memory, 0, sizeof(calc.memory));
+    layer_move(3);
+}
+
+static void test_registers_in_expressions(void) {
+    reset();
+    type("3+4=");
+    memory_key(L3_MEM_PLUS);
+    store_to(L3_REG_B);
+    CHECK(calc.memory[MEM_M] == 7);
+    CHECK(calc.memory[MEM_B] == 7);
+
+    type("2*");
+    memory_key(L3_REG_B);
+    type("-");
+    memory_key(L3_MEM_RECALL);
+    type("=");
+    CHECK(strcmp(calc.last_answer, "7.00") == 0);
+
+    tap(L3_PRINT_ANS);
+    CHECK(strcmp(sent_string, "7.00") == 0);
+}
+
+static void test_store_evaluates_pending_input(void) {
+    reset();
+    type("5*6");
+    store_to(L3_REG_A);
+    CHECK(calc.memory[MEM_A] == 30);
+}
+
+static void test_store_pending_cleared_on_release(void) {
+    reset();
+    key(L3_PRINT_ANS, true);
+    tap(L3_MEM_STORE);
+    key(L3_PRINT_ANS, false);
+    CHECK(!calc.mem_store_pending);
+
+    memory_key(L3_REG_C);
+    CHECK(strcmp(calc.expressions_buffer, "c") == 0);
+}
+
+static void test_nan_not_stored(void) {
+    reset();
+    calc.memory[MEM_M] = 2;
+    type("1+");
+    memory_key(L3_MEM_PLUS);
+    CHECK(isnan(calc.last_value));
+    CHECK(calc.memory[MEM_M] == 2);
+
+    store_to(L3_REG_D);
+    CHECK(calc.memory[MEM_D] == 0);
+}
+
+static void test_register_after_number_ignored(void) {
+    reset();
+    type("5");
+    memory_key(L3_REG_E);
+    type("+2");
+    CHECK(strcmp(calc.expressions_buffer, "5+2") == 0);
+
+    reset();
+    type("5.");
+    memory_key(L3_MEM_RECALL);
+    CHECK(strcmp(calc.expressions_buffer, "5.") == 0);
+}
+
+static void test_oled_shows_memory_layer(void) {
+    reset();
+    type("12");
+    key(L3_PRINT_ANS, true);
+    oled_task_user();
+    CHECK(strcmp(oled_text, "MODE\n\nMEM\n12\n") == 0);
+    key(L3_PRINT_ANS, false);
+    oled_task_user();
+    CHECK(strcmp(oled_text, "MODE\n\nCALC\n12\n") == 0);
+}
+
+int main(void) {
+    test_registers_in_expressions();
+    test_store_evaluates_pending_input();
+    test_store_pending_cleared_on_release();
+    test_nan_not_stored();
+    test_register_after_number_ignored();
+    test_oled_shows_memory_layer();
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all key checks passed\n");
+    return 0;
+}
@@ -0,0 +1,31 @@
+/* The optimize() pass as it was before simplify(): constant folding only.
+ * Include after keymap.c; used as the reference simplify() is checked against. */
+#pragma once
+
+static te_expr *fold(te_expr *n) {
+    if (n->type == TE_CONSTANT || n->type == TE_VARIABLE || !IS_PURE(n->type)) return n;
+
+    int known = 1;
+    int i;
+    for (i = 0; i < ARITY(n->type); ++i) {
+        n->parameters[i] = fold(n->parameters[i]);
+        if (((te_expr*)(n->parameters[i]))->type != TE_CONSTANT) known = 0;
+    }
+    if (known) make_constant(n, te_eval(n));
+    return n;
+}
+
+static te_expr *compile_folded(const char *expression) {
+    /* Like te_compile without simplify(); returns 0 on a parse error. */
+    state s;
+    s.start = s.next = expression;
+    s.lookup = 0;
+    s.lookup_len = 0;
+    next_token(&s);
+    te_expr *root = list(&s);
+    if (root && s.type != TOK_END) {
+        te_free(root);
+        return 0;
+    }
+    return root ? fold(root) : 0;
+}
@@ -0,0 +1,77 @@
+/* Just enough of the QMK headers to build keymap.c on the host. */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SAFE_RANGE 0x7E00
+#define PROGMEM
+#define MATRIX_ROWS 5
+#define MATRIX_COLS 4
+#define LAYOUT(...) {{0}}
+#define TG(layer) (0x5300 | (layer))
+
+enum {
+    KC_TRNS = 1, KC_PSLS, KC_PAST, KC_PMNS, KC_PPLS, KC_ENT, KC_DOT,
+    KC_0, KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9,
+    KC_HOME, KC_UP, KC_PGUP, KC_LEFT, KC_RGHT, KC_END, KC_DOWN, KC_PGDN, KC_INS, KC_DEL,
+    RGB_TOG, RGB_MOD, RGB_HUI, RGB_SAI, RGB_VAI, RGB_HUD, RGB_SAD, RGB_VAD, QK_BOOT,
+    KC_VOLU, KC_VOLD,
+};
+
+typedef struct {
+    struct {
+        bool pressed;
+    } event;
+} keyrecord_t;
+
+static bool debug_enable, debug_matrix;
+
+static uint32_t layer_state;
+static char sent_string[64]; // last string passed to send_string
+
+static inline void tap_code(uint16_t keycode) { (void)keycode; }
+static inline void send_string(const char *str) { snprintf(sent_string, sizeof(sent_string), "%s", str); }
+static inline void layer_move(uint8_t layer) { layer_state = 1UL << layer; }
+static inline void layer_on(uint8_t layer) { layer_state |= 1UL << layer; }
+static inline void layer_off(uint8_t layer) { layer_state &= ~(1UL << layer); }
+
+static inline uint8_t get_highest_layer(uint32_t state) {
+    uint8_t layer = 0;
+    while (state >>= 1) layer++;
+    return layer;
+}
+
+/* OLED output is collected as text, one line per oled_write_ln. */
+#define PSTR(s) (s)
+static char oled_text[256];
+
+static inline void oled_set_cursor(uint8_t col, uint8_t line) {
+    (void)col;
+    (void)line;
+    oled_text[0] = '\0';
+}
+
+static inline void oled_write_P(const char *data, bool invert) {
+    (void)invert;
+    strncat(oled_text, data, sizeof(oled_text) - strlen(oled_text) - 1);
+}
+
+static inline void oled_write_ln(const char *data, bool invert) {
+    oled_write_P(data, invert);
+    oled_write_P("\n", invert);
+}
+
+/* avr-libc number formatting */
+static inline char *dtostrf(double val, signed char width, unsigned char prec, char *s) {
+    sprintf(s, "%*.*f", width, prec, val);
+    return s;
+}
+
+static inline char *dtostre(double val, char *s, unsigned char prec, unsigned char flags) {
+    (void)flags;
+    sprintf(s, "%.*e", prec, val);
+    return s;
+}
@@ -0,0 +1,7 @@
+#!/bin/sh
+# Builds and runs the simplify() benchmark on the host.
+set -e
+# -Wno-array-bounds: upstream TinyExpr's new_expr allocates nodes smaller than te_expr for arity 0.
+cd "$(dirname "$0")"
+${CC:-cc} -std=gnu11 -O2 -Wall -Wextra -Wno-array-bounds -I. bench.c -lm -o bench
+./bench
@@ -0,0 +1,7 @@
+#!/bin/sh
+# Runs footprint.py on a checked-in map and call graph and compares with the expected report.
+# The fixture is keymap.c built on the host with -fcallgraph-info=su, keeping only keymap.o in the map.
+set -e
+cd "$(dirname "$0")"
+python3 ../footprint.py footprint/keymap.map footprint/keymap.ci footprint/libc.su | diff -u footprint/expected.txt -
+echo "footprint report matches"
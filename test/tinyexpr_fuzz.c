@@ -0,0 +1,214 @@
+/* Fuzzing harness for the TinyExpr section of keymap.c.
+ *
+ * Every input is compiled and evaluated the way L3_EQUALS does it, cut to the
+ * 63 characters expressions_buffer can hold. An input fails if it crashes, leaks,
+ * or goes over one of the budgets below, so worst-case cost stays known. It also
+ * fails if simplify() changes a result compared to plain constant folding.
+ *
+ * libFuzzer: clang -fsanitize=fuzzer,address -DLIBFUZZER tinyexpr_fuzz.c -lm
+ * AFL:       afl-fuzz -i corpus -o findings -- ./tinyexpr_fuzz @@
+ * Replay:    ./run_corpus.sh
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Budgets for one expression of at most EXPRESSIONS_BUFF_SIZE-1 characters.
+ * Each character yields at most one node, plus one for a missing operand at the end,
+ * and each level of the tree needs an operator and an operand, plus one leading sign. */
+#ifndef ALLOC_BUDGET
+#define ALLOC_BUDGET EXPRESSIONS_BUFF_SIZE              // new_expr calls per te_compile
+#endif
+#ifndef DEPTH_BUDGET
+#define DEPTH_BUDGET (EXPRESSIONS_BUFF_SIZE / 2 + 1)    // recursion in optimize, te_eval and te_free
+#endif
+#ifndef CPU_BUDGET_NS
+#define CPU_BUDGET_NS 1000000                           // host CPU time to compile, evaluate and free
+#endif
+
+static long alloc_count;        // allocations since the last reset
+static long alloc_live;         // allocations not yet freed
+static long alloc_fail_at = -1; // index of the allocation to fail, or -1
+
+static void *fuzz_malloc(size_t size) {
+    if (alloc_count++ == alloc_fail_at) return NULL;
+    void *p = malloc(size);
+    if (p) alloc_live++;
+    return p;
+}
+
+static void fuzz_free(void *p) {
+    if (p) alloc_live--;
+    free(p);
+}
+
+#define QMK_KEYBOARD_H "qmk_stub.h"
+#define malloc fuzz_malloc
+#define free fuzz_free
+#include "../keymap.c"
+#include "fold_only.h"
+#undef malloc
+#undef free
+
+/* Register values the simplified and folded trees are compared under. */
+static const double register_values[] = {0.0, -0.0, 1.0, -3.0, 0.1, INFINITY, NAN};
+#define REGISTER_VALUE_COUNT (int)(sizeof(register_values) / sizeof(register_values[0]))
+
+typedef struct fuzz_stats {
+    long allocs;
+    int depth;
+    long cpu_ns;
+} fuzz_stats;
+
+static fuzz_stats worst;
+
+static int tree_depth(const te_expr *n) {
+    int depth = 0;
+    int i;
+    if (!n) return 0;
+    for (i = 0; i < ARITY(n->type); ++i) {
+        const int d = tree_depth(n->parameters[i]);
+        if (d > depth) depth = d;
+    }
+    return depth + 1;
+}
+
+static long cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void over_budget(const char *expression, const char *what, long value, long budget) {
+    fprintf(stderr, "over budget: %s %ld > %ld for \"%s\"\n", what, value, budget, expression);
+    abort();
+}
+
+static void check_expression(const char *expression) {
+    fuzz_stats st;
+    int error;
+
+    /* Depth of the tree as parsed, before optimize() shrinks it. */
+    state s;
+    s.start = s.next = expression;
+    s.lookup = 0;
+    s.lookup_len = 0;
+    next_token(&s);
+    te_expr *raw = list(&s);
+    st.depth = raw ? tree_depth(raw) : 0;
+    te_free(raw);
+
+    alloc_count = 0;
+    const long start = cpu_ns();
+    te_expr *n = te_compile(expression, 0, 0, &error);
+    if (n) {
+        te_eval(n);
+        te_free(n);
+    }
+    st.cpu_ns = cpu_ns() - start;
+    st.allocs = alloc_count;
+
+    if (alloc_live != 0) over_budget(expression, "leaked nodes", alloc_live, 0);
+    if (st.allocs > ALLOC_BUDGET) over_budget(expression, "allocations", st.allocs, ALLOC_BUDGET);
+    if (st.depth > DEPTH_BUDGET) over_budget(expression, "tree depth", st.depth, DEPTH_BUDGET);
+    if (st.cpu_ns > CPU_BUDGET_NS) over_budget(expression, "cpu ns", st.cpu_ns, CPU_BUDGET_NS);
+
+    if (st.allocs > worst.allocs) worst.allocs = st.allocs;
+    if (st.depth > worst.depth) worst.depth = st.depth;
+    if (st.cpu_ns > worst.cpu_ns) worst.cpu_ns = st.cpu_ns;
+}
+
+static int same_result(double a, double b) {
+    /* Equal up to the sign of a zero, which simplify() does not preserve. */
+    return a == b || (isnan(a) && isnan(b));
+}
+
+static void check_simplify(const char *expression) {
+    /* Every register gets every value, both all at once and rotated across registers. */
+    te_expr *folded = compile_folded(expression);
+    te_expr *simplified = te_compile(expression, 0, 0, 0);
+    int round, i;
+
+    if (!folded != !simplified) {
+        fprintf(stderr, "simplify changed whether \"%s\" parses\n", expression);
+        abort();
+    }
+
+    for (round = 0; simplified && round < 2 * REGISTER_VALUE_COUNT; ++round) {
+        for (i = 0; i < MEM_COUNT; ++i) {
+            const int rotate = round < REGISTER_VALUE_COUNT ? 0 : i;
+            calc.memory[i] = register_values[(round + rotate) % REGISTER_VALUE_COUNT];
+        }
+        const double expected = te_eval(folded);
+        const double actual = te_eval(simplified);
+        if (!same_result(expected, actual)) {
+            fprintf(stderr, "simplify changed \"%s\" from %g to %g (round %d)\n", expression, expected, actual, round);
+            abort();
+        }
+    }
+
+    memset(calc.memory, 0, sizeof(calc.memory));
+    te_free(folded);
+    te_free(simplified);
+}
+
+static void check_allocation_failures(const char *expression) {
+    /* Fail each allocation in turn; te_compile must clean up and report it. */
+    long total, i;
+    int error;
+
+    alloc_count = 0;
+    te_free(te_compile(expression, 0, 0, &error));
+    total = alloc_count;
+
+    for (i = 0; i < total; ++i) {
+        alloc_count = 0;
+        alloc_fail_at = i;
+        te_expr *n = te_compile(expression, 0, 0, &error);
+        alloc_fail_at = -1;
+        if (!n && error == 0) over_budget(expression, "unreported allocation failure at", i, total);
+        te_free(n);
+        if (alloc_live != 0) over_budget(expression, "leaked nodes after failed allocation", alloc_live, 0);
+    }
+}
+
+static void check_input(const uint8_t *data, size_t size) {
+    char expression[EXPRESSIONS_BUFF_SIZE];
+    size_t len = 0;
+    while (len < size && len + 1 < EXPRESSIONS_BUFF_SIZE && data[len]) {
+        expression[len] = data[len];
+        len++;
+    }
+    expression[len] = '\0';
+
+    check_expression(expression);
+    check_simplify(expression);
+    check_allocation_failures(expression);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    check_input(data, size);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+int main(int argc, char **argv) {
+    int i;
+    for (i = 1; i < argc; ++i) {
+        uint8_t data[4096];
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            perror(argv[i]);
+            return 1;
+        }
+        const size_t size = fread(data, 1, sizeof(data), f);
+        fclose(f);
+        check_input(data, size);
+    }
+    printf("%d inputs, worst case: %ld allocations (budget %d), depth %d (budget %d), %ld ns (budget %d)\n",
+           argc - 1, worst.allocs, ALLOC_BUDGET, worst.depth, DEPTH_BUDGET, worst.cpu_ns, CPU_BUDGET_NS);
+    return 0;
+}
+#endif